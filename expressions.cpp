@@ -7,6 +7,11 @@
 // numbers/parameters store their value directly
 // evaluate() works recursively on the daughter nodes
 
+// signature of functions from the function registry (see formula::register_function)
+// the arguments are passed as an array, its length is given by the registered arity
+typedef double (*function_kernel)(const double* arguments);
+const unsigned int max_function_arity = 8;
+
 class generic_expression{
 	public:
 	virtual double evaluate(const map<unsigned int,double>& parameters) = 0;
@@ -99,6 +104,139 @@ class ratio_expression : public generic_expression{
 	};
 };
 
+class less_expression : public generic_expression{
+	generic_expression *ptr_term1, *ptr_term2;
+	
+	public:	
+	less_expression(generic_expression *ptr_in1, generic_expression *ptr_in2){
+		ptr_term1 = ptr_in1;
+		ptr_term2 = ptr_in2;
+	};		
+	
+	double evaluate(const map<unsigned int,double>& parameters) override final{
+		return (ptr_term1->evaluate(parameters) < ptr_term2->evaluate(parameters)) ? 1 : 0;
+	};
+};
+
+class greater_expression : public generic_expression{
+	generic_expression *ptr_term1, *ptr_term2;
+	
+	public:	
+	greater_expression(generic_expression *ptr_in1, generic_expression *ptr_in2){
+		ptr_term1 = ptr_in1;
+		ptr_term2 = ptr_in2;
+	};		
+	
+	double evaluate(const map<unsigned int,double>& parameters) override final{
+		return (ptr_term1->evaluate(parameters) > ptr_term2->evaluate(parameters)) ? 1 : 0;
+	};
+};
+
+class less_equal_expression : public generic_expression{
+	generic_expression *ptr_term1, *ptr_term2;
+	
+	public:	
+	less_equal_expression(generic_expression *ptr_in1, generic_expression *ptr_in2){
+		ptr_term1 = ptr_in1;
+		ptr_term2 = ptr_in2;
+	};		
+	
+	double evaluate(const map<unsigned int,double>& parameters) override final{
+		return (ptr_term1->evaluate(parameters) <= ptr_term2->evaluate(parameters)) ? 1 : 0;
+	};
+};
+
+class greater_equal_expression : public generic_expression{
+	generic_expression *ptr_term1, *ptr_term2;
+	
+	public:	
+	greater_equal_expression(generic_expression *ptr_in1, generic_expression *ptr_in2){
+		ptr_term1 = ptr_in1;
+		ptr_term2 = ptr_in2;
+	};		
+	
+	double evaluate(const map<unsigned int,double>& parameters) override final{
+		return (ptr_term1->evaluate(parameters) >= ptr_term2->evaluate(parameters)) ? 1 : 0;
+	};
+};
+
+class equal_expression : public generic_expression{
+	generic_expression *ptr_term1, *ptr_term2;
+	
+	public:	
+	equal_expression(generic_expression *ptr_in1, generic_expression *ptr_in2){
+		ptr_term1 = ptr_in1;
+		ptr_term2 = ptr_in2;
+	};		
+	
+	double evaluate(const map<unsigned int,double>& parameters) override final{
+		return (ptr_term1->evaluate(parameters) == ptr_term2->evaluate(parameters)) ? 1 : 0;
+	};
+};
+
+class not_equal_expression : public generic_expression{
+	generic_expression *ptr_term1, *ptr_term2;
+	
+	public:	
+	not_equal_expression(generic_expression *ptr_in1, generic_expression *ptr_in2){
+		ptr_term1 = ptr_in1;
+		ptr_term2 = ptr_in2;
+	};		
+	
+	double evaluate(const map<unsigned int,double>& parameters) override final{
+		return (ptr_term1->evaluate(parameters) != ptr_term2->evaluate(parameters)) ? 1 : 0;
+	};
+};
+
+class and_expression : public generic_expression{
+	//logical and, any non-zero value counts as true. the second argument is only evaluated if the first is true
+	generic_expression *ptr_term1, *ptr_term2;
+	
+	public:	
+	and_expression(generic_expression *ptr_in1, generic_expression *ptr_in2){
+		ptr_term1 = ptr_in1;
+		ptr_term2 = ptr_in2;
+	};		
+	
+	double evaluate(const map<unsigned int,double>& parameters) override final{
+		return (ptr_term1->evaluate(parameters) != 0 && ptr_term2->evaluate(parameters) != 0) ? 1 : 0;
+	};
+};
+
+class or_expression : public generic_expression{
+	//logical or, any non-zero value counts as true. the second argument is only evaluated if the first is false
+	generic_expression *ptr_term1, *ptr_term2;
+	
+	public:	
+	or_expression(generic_expression *ptr_in1, generic_expression *ptr_in2){
+		ptr_term1 = ptr_in1;
+		ptr_term2 = ptr_in2;
+	};		
+	
+	double evaluate(const map<unsigned int,double>& parameters) override final{
+		return (ptr_term1->evaluate(parameters) != 0 || ptr_term2->evaluate(parameters) != 0) ? 1 : 0;
+	};
+};
+
+class if_expression : public generic_expression{
+	//if(condition, a, b) returns a for non-zero condition and b otherwise, only the selected branch is evaluated
+	generic_expression *ptr_condition, *ptr_then, *ptr_else;
+	
+	public:
+	if_expression(generic_expression *ptr_in1, generic_expression *ptr_in2, generic_expression *ptr_in3){
+		ptr_condition = ptr_in1;
+		ptr_then = ptr_in2;
+		ptr_else = ptr_in3;
+	};
+	
+	double evaluate(const map<unsigned int,double>& parameters) override final{
+		if(ptr_condition->evaluate(parameters) != 0){
+			return ptr_then->evaluate(parameters);
+		};
+		return ptr_else->evaluate(parameters);
+	};
+};
+
 class sqrt_expression : public generic_expression{
 	generic_expression *ptr_term;
 	
@@ -177,6 +315,29 @@ class neg_expression : public generic_expression{
 	};
 };
 
+class function_expression : public generic_expression{
+	// registered function of arbitrary arity, the kernel is called directly with the evaluated arguments
+	vector<generic_expression*> arguments;
+	function_kernel kernel;
+	
+	public:
+	function_expression(const vector<generic_expression*>& ptr_in, function_kernel kernel_in){
+		if(ptr_in.size() > max_function_arity){ //evaluate() collects the arguments in a fixed size array
+			throw runtime_error("function with more than the maximum number of arguments");
+		};
+		arguments = ptr_in;
+		kernel = kernel_in;
+	};
+	
+	double evaluate(const map<unsigned int,double>& parameters) override final{
+		double values[max_function_arity];
+		for(size_t i = 0; i < arguments.size(); i++){
+			values[i] = arguments[i]->evaluate(parameters);
+		};
+		return kernel(values);
+	};
+};
+
 class number_expression : public generic_expression{
 	double myvalue;
 			
@@ -17,12 +17,18 @@ formula::~formula(){
 
 formula::formula(const formula& other){
 	raw_formula = other.raw_formula;
+	relaxed_math = other.relaxed_math;
+	optimize = other.optimize;
+	bound_parameters = other.bound_parameters;
 	init(); 
 };
 	
 formula& formula::operator=(const formula& other){
 	clear(); //delete all old data and overwrite with new info
 	raw_formula = other.raw_formula;
+	relaxed_math = other.relaxed_math;
+	optimize = other.optimize;
+	bound_parameters = other.bound_parameters;
 	init();
 	return *this;
 };
@@ -37,6 +43,10 @@ formula::formula(formula&& other){
 	// we can keep the pointers, since we are reusing other's expressions,
 	ptr_root = other.ptr_root;
 	parameters = other.parameters; 
+	relaxed_math = other.relaxed_math;
+	optimize = other.optimize;
+	bound_parameters = other.bound_parameters;
+	error_message = other.error_message;
 	//we are re-using other's expressions, so make sure other's destructor does not delete any
 	other.all_associated_expressions.clear();
 };
@@ -51,6 +61,10 @@ formula& formula::operator=(formula&& other){
 	all_associated_expressions = other.all_associated_expressions;
 	ptr_root = other.ptr_root;
 	parameters = other.parameters;		
+	relaxed_math = other.relaxed_math;
+	optimize = other.optimize;
+	bound_parameters = other.bound_parameters;
+	error_message = other.error_message;
 	other.all_associated_expressions.clear();
 	return *this;
 };
@@ -66,12 +80,14 @@ void formula::delete_expressions(){
 
 void formula::clear(){ //resets object into uninitialized state, deletes all data
 	raw_formula = "";
+	error_message = "";
 	ptr_root = nullptr;	
 	
 	pre_tokens.clear();
 	standard_formula.clear();
 	postfix_formula.clear();
 	parameters.clear();
+	bound_parameters.clear();
 
 	delete_expressions();		
 };	
@@ -85,15 +101,19 @@ void formula::init(){ //main function to compile expression tree
 	try{
 		string_to_tokens();
 		standard_to_postfix();
+		if(optimize) optimize_postfix();
 		construct_expression_tree();			
 	} 
 	catch(const std::runtime_error& re){
 		cerr << re.what() << endl;
 		cerr << "formula could not be initialized" << endl;
 		// do some tidying up, in case of incomplete initialization
-		string tmp = raw_formula; //but keep raw formula string, clean() deletes everything otherwise
+		string tmp = raw_formula; //but keep raw formula string and bound parameters, clean() deletes everything otherwise
+		map<unsigned int,double> tmp_bound = bound_parameters;
 		clear();
 		raw_formula = tmp;
+		bound_parameters = tmp_bound;
+		error_message = re.what();
 	};
 	return;						
 };		
@@ -104,6 +124,28 @@ void formula::init(const string& str){
 	init();
 };
 
+void formula::set_relaxed_math(bool flag){
+	relaxed_math = flag;
+};
+
+void formula::set_optimization(bool flag){
+	optimize = flag;
+};
+
+formula formula::bind(const map<unsigned int, double>& values){
+	// the residual formula is parsed from the same string, string_to_tokens() substitutes the bound parameters
+	formula residual;
+	residual.raw_formula = raw_formula;
+	residual.relaxed_math = relaxed_math;
+	residual.optimize = optimize;
+	residual.bound_parameters = bound_parameters;
+	for(auto it = values.begin(); it != values.end(); it++){
+		if(parameters.count(it->first) != 0) residual.bound_parameters[it->first] = it->second;
+	};
+	residual.init();
+	return residual;
+};
+
 double formula::evaluate(const map<unsigned int, double>& params){
 	if(ptr_root != nullptr){
 		return ptr_root->evaluate(params);
@@ -126,8 +168,107 @@ map<unsigned int, double> formula::get_parameter_prototype(){
 const string& formula::get_formula_string(){
 	return raw_formula;
 };
+
+bool formula::is_initialized(){
+	return ptr_root != nullptr;
+};
+
+const string& formula::get_error(){
+	return error_message;
+};
 	
 
+// default functions of the registry
+// min, max and clamp follow fmin/fmax: a NaN argument is ignored unless all arguments are NaN, independent of the order
+static double kernel_min(const double* x) {return fmin(x[0], x[1]);};
+static double kernel_max(const double* x) {return fmax(x[0], x[1]);};
+static double kernel_abs(const double* x) {return fabs(x[0]);};
+static double kernel_atan2(const double* x) {return atan2(x[0], x[1]);};
+static double kernel_clamp(const double* x) {return fmin(fmax(x[0], x[1]), x[2]);};
+static double kernel_tanh(const double* x) {return tanh(x[0]);};
+
+function_registry& formula::registry(){
+	static function_registry functions;
+	static bool initialized = false;
+	if(!initialized){
+		initialized = true;
+		register_function("min", 2, kernel_min);
+		register_function("max", 2, kernel_max);
+		register_function("abs", 1, kernel_abs);
+		register_function("atan2", 2, kernel_atan2);
+		register_function("clamp", 3, kernel_clamp);
+		register_function("tanh", 1, kernel_tanh);
+	};
+	return functions;
+};
+
+const function_registry& formula::get_function_registry(){
+	return registry();
+};
+
+// maps operators, brackets and built-in functions to their tokens
+// warning: care must be taken here when initializing the tokens
+// if e.g. accidentally '*' were defined as unary operator, the algorithm would blindly treat it as such
+static const unordered_map<string,math_token>& keyword_tokens(){
+	static const unordered_map<string,math_token> keywords = {
+		{"sin", {tk_unary, tk_sin, 0}},
+		{"exp", {tk_unary, tk_exp, 0}},
+		{"cos", {tk_unary, tk_cos, 0}},
+		{"sqrt", {tk_unary, tk_sqrt, 0}},
+		{"log", {tk_unary, tk_log, 0}},
+		{"+", {tk_binary, tk_plus, 0}},
+		{"-", {tk_binary, tk_minus, 0}},
+		{"*", {tk_binary, tk_times, 1}},
+		{"/", {tk_binary, tk_ratio, 1}},
+		{"^", {tk_binary, tk_power, 2}},
+		{"(", {tk_bracket, tk_open, 0}},
+		{")", {tk_bracket, tk_close, 0}},
+		{",", {tk_bracket, tk_comma, 0}},
+		{"<", {tk_binary, tk_less, -1}},
+		{">", {tk_binary, tk_greater, -1}},
+		{"<=", {tk_binary, tk_less_equal, -1}},
+		{">=", {tk_binary, tk_greater_equal, -1}},
+		{"==", {tk_binary, tk_equal, -1}},
+		{"!=", {tk_binary, tk_not_equal, -1}},
+		{"&&", {tk_binary, tk_and, -2}},
+		{"||", {tk_binary, tk_or, -3}},
+		{"if", {tk_function, tk_if, 0}}
+	};
+	return keywords;
+};
+
+void formula::register_function(const string& name, unsigned int arity, function_kernel kernel){
+	// names must look like identifiers and must not collide with parameters (x, x0, x1, ...) or built-in functions
+	if(name.empty() || !(isalpha(name[0]) || name[0] == '_') || name.find_first_not_of("abcdefghijklmnopqrstuvwxyzABCDEFGHIJKLMNOPQRSTUVWXYZ0123456789_") != name.npos){
+		throw runtime_error("cannot register function '" + name + "': invalid name");
+	};
+	if(name[0] == 'x' && name.find_first_not_of("0123456789", 1) == name.npos){
+		throw runtime_error("cannot register function '" + name + "': name is reserved for parameters");
+	};
+	if(keyword_tokens().count(name) != 0){
+		throw runtime_error("cannot register function '" + name + "': built-in functions cannot be replaced");
+	};
+	if(arity == 0 || arity > max_function_arity || kernel == nullptr){
+		throw runtime_error("cannot register function '" + name + "': invalid arity or kernel");
+	};
+	function_registry& functions = registry();
+	auto it = functions.index.find(name);
+	if(it != functions.index.end()){
+		functions.functions[it->second].arity = arity;
+		functions.functions[it->second].kernel = kernel;
+		return;
+	};
+	functions.index.emplace(name, functions.functions.size());
+	functions.functions.push_back({name, arity, kernel});
+};
+
+// number of arguments of a function token, if(condition, a, b) is the only built-in function with more than one
+static unsigned int function_arity(const math_token& token){
+	if(token.type == tk_unary) return 1;
+	if(token.name == tk_if) return 3;
+	return formula::get_function_registry().functions[(unsigned int)token.value].arity;
+};
+
 void formula::string_to_tokens(){
 	//this function involves three steps
 	// (1) split formula string into substrings by using operators, brackets and spaces as delimiters, result stored in pre_tokens
@@ -141,13 +282,27 @@ void formula::string_to_tokens(){
 	// characters are stored in buffer
 	for(auto it = raw_formula.begin(); it != raw_formula.end(); ++it){
 		char tmp = *it;
-		if( (tmp =='(') || (tmp == ')') || (tmp == ' ') || (tmp == '+') || (tmp== '-') || (tmp== '*') || (tmp == '/') || (tmp == '^') ){
+		if( (tmp =='(') || (tmp == ')') || (tmp == ' ') || (tmp == '+') || (tmp== '-') || (tmp== '*') || (tmp == '/') || (tmp == '^') || (tmp == ',') ){
 			//previous substring ended. It is stored in buffer, add it to the pre_tokens...
 			if(buffer != "") pre_tokens.push_back(buffer); //...but not if it is a space
 			buffer = "";
 			if( tmp != ' ' ) pre_tokens.push_back(string(1,tmp));
 			//if delimiter is not a space, it is an operator/bracket > add it to the list of tokens
 		}
+		else if( (tmp == '<') || (tmp == '>') || (tmp == '=') || (tmp == '!') || (tmp == '&') || (tmp == '|') ){
+			//comparison and logical operators, which can consist of two characters (<=, ==, &&, ...)
+			if(buffer != "") pre_tokens.push_back(buffer);
+			buffer = string(1,tmp);
+			if(it+1 != raw_formula.end()){
+				string two_chars = buffer + *(it+1);
+				if(two_chars == "<=" || two_chars == ">=" || two_chars == "==" || two_chars == "!=" || two_chars == "&&" || two_chars == "||"){
+					buffer = two_chars;
+					++it;
+				};
+			};
+			pre_tokens.push_back(buffer);
+			buffer = "";
+		}
 		else{ //no delimiter found, substring keeps on going
 			buffer += tmp;
 		};
@@ -180,25 +335,35 @@ void formula::string_to_tokens(){
 				token.type = tk_literal;
 				token.name = tk_parameter;
 				token.value = strtod(cstr,nullptr);
+				if(token.value > numeric_limits<unsigned int>::max()){
+					throw runtime_error("parsing error: parameter index " + str + " too large");
+				};
+				auto bound = bound_parameters.find((unsigned int)token.value);
+				if(bound != bound_parameters.end()){ //parameter fixed by bind(), it becomes a number
+					token.name = tk_number;
+					token.value = bound->second;
+				};
 				standard_formula.push_back(token);
 				continue;
 			};
 		};				
 		
-		// warning: care must be taken here when initializing the tokens
-		// if e.g. accidentally '*' were defined as unary operator, the algorithm would blindly treat it as such
-		if(str=="sin") {token.type = tk_unary; token.name = tk_sin; token.value = 0; standard_formula.push_back(token);continue;}
-		if(str=="exp") {token.type = tk_unary; token.name = tk_exp; token.value = 0;standard_formula.push_back(token);continue;};
-		if(str=="cos") {token.type = tk_unary; token.name = tk_cos; token.value = 0; standard_formula.push_back(token);continue;}
-		if(str=="sqrt") {token.type = tk_unary; token.name = tk_sqrt; token.value = 0;standard_formula.push_back(token);continue;};
-		if(str=="log") {token.type = tk_unary; token.name = tk_log; token.value = 0;standard_formula.push_back(token);continue;};
-		if(str=="+") {token.type = tk_binary; token.name = tk_plus; token.value = 0;standard_formula.push_back(token);continue;};
-		if(str=="-") {token.type = tk_binary; token.name = tk_minus; token.value = 0;standard_formula.push_back(token);continue;};
-		if(str=="*") {token.type = tk_binary; token.name = tk_times; token.value = 1;standard_formula.push_back(token);continue;};
-		if(str=="/") {token.type = tk_binary; token.name = tk_ratio; token.value = 1;standard_formula.push_back(token);continue;};
-		if(str=="^") {token.type = tk_binary; token.name = tk_power; token.value = 2;standard_formula.push_back(token);continue;};
-		if(str=="(") {token.type = tk_bracket; token.name = tk_open; token.value = 0;standard_formula.push_back(token);continue;};
-		if(str==")") {token.type = tk_bracket; token.name = tk_close; token.value = 0;standard_formula.push_back(token);continue;};
+		// operators, brackets and built-in functions
+		auto keyword = keyword_tokens().find(str);
+		if(keyword != keyword_tokens().end()){
+			standard_formula.push_back(keyword->second);
+			continue;
+		};
+		
+		// registered functions, token.value holds the position in the registry
+		auto function = get_function_registry().index.find(str);
+		if(function != get_function_registry().index.end()){
+			token.type = tk_function;
+			token.name = tk_registered;
+			token.value = function->second;
+			standard_formula.push_back(token);
+			continue;
+		};
 		
 		//the code should never get to here unless the input string contained a non-defined sequence
 		throw runtime_error("parsing error in input string"); 
@@ -207,7 +372,10 @@ void formula::string_to_tokens(){
 
 	// part (3a)
 	//resolve ambiguity in minus/negation
-	//change tk_minus to tk_neg if the preceding token is either nothing, an opening bracket or a binary operator
+	//change tk_minus to tk_neg if the preceding token is either nothing, an opening bracket, a comma or a binary operator
+	if(standard_formula.empty()){
+		throw runtime_error("parsing error: no tokens in input string");
+	};
 	auto it = standard_formula.begin();
 	if(it->name==tk_minus){
 			it->type = tk_unary;
@@ -216,7 +384,7 @@ void formula::string_to_tokens(){
 		};
 	if(standard_formula.size() > 1){		
 		for(it = it+1; it != standard_formula.end(); it++){
-			if(it->name==tk_minus && ((it-1)->type == tk_binary || (it-1)->name == tk_open)){
+			if(it->name==tk_minus && ((it-1)->type == tk_binary || (it-1)->name == tk_open || (it-1)->name == tk_comma)){
 				it->type = tk_unary;
 				it->name = tk_neg;
 				it->value = 0;
@@ -243,37 +411,93 @@ void formula::string_to_tokens(){
 
 }; 
 		
+// appends a token to the postfix formula and keeps track of how many values the postfix formula leaves on the buffer
+// operators need enough values to act on, otherwise they would take operands from outside their brackets
+static void emit_token(const math_token& token, deque<math_token>& postfix, unsigned int& values){
+	if(token.type == tk_literal){
+		values++;
+	}
+	else{
+		unsigned int arity = (token.type == tk_binary) ? 2 : function_arity(token);
+		if(values < arity){
+			throw runtime_error("syntax error: operator or function with insufficient number of arguments");
+		};
+		values -= arity - 1;
+	};
+	postfix.push_back(token);
+};
+
 void formula::standard_to_postfix(){
 	// this converts the tokenized raw string into postfix notation using the shunting yard algorithm
 	// the tokenized original string is destroyed in the process
+	// argument_counts has one entry per open bracket in buffer, counting the comma separated arguments within that bracket
+	// argument_marks has one entry per open bracket as well, the number of values before the current argument started.
+	// every argument (and every bracket) has to add exactly one value, which rules out empty arguments like min(,2)
 	deque<math_token> buffer;
+	deque<unsigned int> argument_counts;
+	deque<unsigned int> argument_marks;
+	unsigned int values = 0;
 	math_token current_token;
 	while(!standard_formula.empty()){
 		current_token = standard_formula.front();
 		standard_formula.pop_front();
-		if(current_token.type==tk_literal) postfix_formula.push_back(current_token); //is it a literal? (number/parameter)
-		if(current_token.type==tk_unary) buffer.push_back(current_token); //unary operators
+		if(current_token.type==tk_literal) emit_token(current_token, postfix_formula, values); //is it a literal? (number/parameter)
+		if(current_token.type==tk_function && (standard_formula.empty() || standard_formula.front().name != tk_open)){
+			throw runtime_error("error interpreting formula: function without argument list");
+		};
+		if(current_token.type==tk_unary || current_token.type==tk_function) buffer.push_back(current_token); //functions
 		if(current_token.type==tk_binary){		//for binary operators precedence matters	
 			while(!buffer.empty() && (buffer.back().type == tk_binary) && (buffer.back().value >= current_token.value)){
-				postfix_formula.push_back(buffer.back());
+				emit_token(buffer.back(), postfix_formula, values);
 				buffer.pop_back();
 			};
 			buffer.push_back(current_token);
 		};
-		if(current_token.name==tk_open) buffer.push_back(current_token); //dealing with brackets
+		if(current_token.name==tk_open){ //dealing with brackets
+			buffer.push_back(current_token);
+			argument_counts.push_back(1);
+			argument_marks.push_back(values);
+		};
+		if(current_token.name==tk_comma){ //argument separator, finish the previous argument
+			while(!buffer.empty() && buffer.back().name != tk_open){
+				emit_token(buffer.back(), postfix_formula, values);
+				buffer.pop_back();
+			};
+			if(buffer.empty()){
+				throw runtime_error("error interpreting formula: comma outside of brackets");
+			};
+			if(values != argument_marks.back() + 1){
+				throw runtime_error("error interpreting formula: empty or incomplete function argument");
+			};
+			argument_counts.back()++;
+			argument_marks.back() = values;
+		};
 		if(current_token.name==tk_close){
 			bool found_matching_bracket = false;
 			while(!buffer.empty() && buffer.back().name != tk_open){ //pop and add everything in between open and closing bracket
-				postfix_formula.push_back(buffer.back());
+				emit_token(buffer.back(), postfix_formula, values);
 				buffer.pop_back();
 			};
-			if(buffer.back().name == tk_open){
+			unsigned int arguments = 1;
+			if(!buffer.empty() && buffer.back().name == tk_open){
 				buffer.pop_back(); //found matching opening bracket, pop and discard
 				found_matching_bracket = true;
+				arguments = argument_counts.back();
+				argument_counts.pop_back();
+				if(values != argument_marks.back() + 1){
+					throw runtime_error("error interpreting formula: empty or incomplete expression in brackets");
+				};
+				argument_marks.pop_back();
 			};
-			if(!buffer.empty() && buffer.back().type == tk_unary){ //this is a function applied to whole bracket
-				postfix_formula.push_back(buffer.back());
+			if(!buffer.empty() && (buffer.back().type == tk_unary || buffer.back().type == tk_function)){ //this is a function applied to whole bracket
+				if(arguments != function_arity(buffer.back())){
+					throw runtime_error("error interpreting formula: wrong number of function arguments");
+				};
+				emit_token(buffer.back(), postfix_formula, values);
 				buffer.pop_back();
+			}
+			else if(arguments != 1){
+				throw runtime_error("error interpreting formula: comma separated list outside of function arguments");
 			};
 			if(!found_matching_bracket){
 				throw runtime_error("error interpreting formula: unmatched closing bracket");
@@ -284,11 +508,269 @@ void formula::standard_to_postfix(){
 		if(buffer.back().name == tk_open){
 			throw runtime_error("error interpreting formula: unmatched opening bracket");
 		};
-		postfix_formula.push_back(buffer.back());
+		emit_token(buffer.back(), postfix_formula, values);
 		buffer.pop_back();
 	};
 };
 
+// helper functions for optimize_postfix(), not part of formula class
+
+// number of arguments an operator token takes from the postfix buffer
+static unsigned int token_arity(const math_token& token){
+	if(token.type == tk_unary) return 1;
+	if(token.type == tk_binary) return 2;
+	if(token.type == tk_function) return function_arity(token);
+	return 0;
+};
+
+// cost model: rough latency of each operation, measured in units of one addition
+static double token_cost(const math_token& token){
+	switch(token.name){
+		case tk_number: case tk_parameter: return 0;
+		case tk_plus: case tk_minus: case tk_neg: case tk_neg2: case tk_times: return 1;
+		case tk_ratio: return 4;
+		case tk_sqrt: return 5;
+		case tk_sin: case tk_cos: case tk_exp: case tk_log: return 20;
+		case tk_power: return 40;
+		case tk_registered: return 10;
+		case tk_less: case tk_greater: case tk_less_equal: case tk_greater_equal: case tk_equal: case tk_not_equal: return 1;
+		case tk_and: case tk_or: case tk_if: return 2;
+		default: return 1;
+	};
+};
+
+// chains of these may be regrouped, up to rounding
+static bool is_associative(const math_token& token){
+	return token.name == tk_plus || token.name == tk_times;
+};
+
+// rebuilds chains of + and * such that the critical path is as short as possible
+// e.g. ((a+b)+c)+d becomes (a+b)+(c+d), so both inner sums can be computed in parallel
+// operands are combined pairwise, always taking the two with the smallest latency first (like huffman coding, using a min-heap)
+// nodes are handled in postfix order, so the operands of a chain are final and their latency is known when the chain is rebuilt
+// the root of each chain keeps its position in nodes, all other new nodes are appended
+static void reassociate(vector<token_node>& nodes){
+	size_t original_size = nodes.size();
+	vector<double> latencies(original_size, 0);
+	// a chain consists of all nodes with the same operator as its root, which has a different operator above it
+	vector<bool> chain_root(original_size, true);
+	for(size_t i = 0; i < original_size; i++){
+		if(!is_associative(nodes[i].token)) continue;
+		for(auto it = nodes[i].children.begin(); it != nodes[i].children.end(); it++){
+			if(nodes[*it].token.name == nodes[i].token.name) chain_root[*it] = false;
+		};
+	};
+	
+	typedef pair<double,unsigned int> heap_entry; //latency and position in operands
+	for(size_t i = 0; i < original_size; i++){
+		math_token token = nodes[i].token;
+		if(!is_associative(token) || !chain_root[i]){
+			double latency = 0;
+			for(auto it = nodes[i].children.begin(); it != nodes[i].children.end(); it++){
+				latency = max(latency, latencies[*it]);
+			};
+			latencies[i] = latency + token_cost(token);
+			continue;
+		};
+		
+		// collect the operands of the chain from left to right
+		vector<unsigned int> operands;
+		vector<unsigned int> pending(nodes[i].children.rbegin(), nodes[i].children.rend());
+		while(!pending.empty()){
+			unsigned int current = pending.back();
+			pending.pop_back();
+			if(nodes[current].token.name == token.name){
+				pending.insert(pending.end(), nodes[current].children.rbegin(), nodes[current].children.rend());
+			}
+			else{
+				operands.push_back(current);
+			};
+		};
+		
+		// ties are broken by position, so operands of equal latency end up in a balanced tree in their original order
+		priority_queue<heap_entry, vector<heap_entry>, greater<heap_entry> > heap;
+		for(unsigned int k = 0; k < operands.size(); k++){
+			heap.push(heap_entry(latencies[operands[k]], k));
+		};
+		while(true){
+			heap_entry first = heap.top();
+			heap.pop();
+			heap_entry second = heap.top();
+			heap.pop();
+			token_node combined;
+			combined.token = token;
+			combined.children.push_back(operands[min(first.second, second.second)]);
+			combined.children.push_back(operands[max(first.second, second.second)]);
+			double latency = token_cost(token) + max(first.first, second.first);
+			if(heap.empty()){
+				nodes[i] = combined;
+				latencies[i] = latency;
+				break;
+			};
+			nodes.push_back(combined);
+			operands.push_back(nodes.size() - 1);
+			heap.push(heap_entry(latency, operands.size() - 1));
+		};
+	};
+};
+
+// computes the result of an operator token whose arguments are all known, mirrors the expression classes
+static double evaluate_token(const math_token& token, const vector<double>& x){
+	switch(token.name){
+		case tk_plus: return x[0] + x[1];
+		case tk_minus: case tk_neg2: return x[0] - x[1];
+		case tk_times: return x[0] * x[1];
+		case tk_ratio: return x[0] / x[1];
+		case tk_power: return pow(x[0], x[1]);
+		case tk_less: return (x[0] < x[1]) ? 1 : 0;
+		case tk_greater: return (x[0] > x[1]) ? 1 : 0;
+		case tk_less_equal: return (x[0] <= x[1]) ? 1 : 0;
+		case tk_greater_equal: return (x[0] >= x[1]) ? 1 : 0;
+		case tk_equal: return (x[0] == x[1]) ? 1 : 0;
+		case tk_not_equal: return (x[0] != x[1]) ? 1 : 0;
+		case tk_and: return (x[0] != 0 && x[1] != 0) ? 1 : 0;
+		case tk_or: return (x[0] != 0 || x[1] != 0) ? 1 : 0;
+		case tk_sin: return sin(x[0]);
+		case tk_cos: return cos(x[0]);
+		case tk_exp: return exp(x[0]);
+		case tk_log: return log(x[0]);
+		case tk_sqrt: return sqrt(x[0]);
+		case tk_neg: return -x[0];
+		case tk_if: return (x[0] != 0) ? x[1] : x[2];
+		case tk_registered: return formula::get_function_registry().functions[(unsigned int)token.value].kernel(x.data());
+		default: throw runtime_error("internal error: cannot evaluate token");
+	};
+};
+
+static void make_number(token_node& node, double value){
+	node.token.type = tk_literal;
+	node.token.name = tk_number;
+	node.token.value = value;
+	node.children.clear();
+};
+
+// replaces every operation whose arguments are all numbers by its result
+// if, && and || are simplified as soon as their first argument is known, before the other arguments are looked at. branches
+// which can never be taken are dropped without being folded, so registered kernels in them are never called
+// the tree is walked depth first with an explicit stack, each entry holds a node and the number of its children already folded
+static void fold_constants(vector<token_node>& nodes, unsigned int root){
+	vector<pair<unsigned int,unsigned int> > pending(1, make_pair(root, 0u));
+	while(!pending.empty()){
+		unsigned int current = pending.back().first;
+		unsigned int folded = pending.back().second;
+		name_token name = nodes[current].token.name;
+		
+		if(folded == 1 && (name == tk_if || name == tk_and || name == tk_or) && nodes[nodes[current].children[0]].token.name == tk_number){
+			double condition = nodes[nodes[current].children[0]].token.value;
+			if(name == tk_if){
+				// the node becomes the selected branch, which is then folded from scratch
+				token_node branch = nodes[nodes[current].children[(condition != 0) ? 1 : 2]];
+				nodes[current] = branch;
+				pending.back().second = 0;
+				continue;
+			};
+			if((name == tk_and && condition == 0) || (name == tk_or && condition != 0)){
+				make_number(nodes[current], (condition != 0) ? 1 : 0);
+				pending.pop_back();
+				continue;
+			};
+			// the result only depends on the second argument now, which still has to be turned into 1 or 0
+			token_node zero;
+			make_number(zero, 0);
+			nodes.push_back(zero);
+			nodes[current].token.name = tk_not_equal;
+			nodes[current].token.value = -1;
+			nodes[current].children[0] = nodes[current].children[1];
+			nodes[current].children[1] = nodes.size() - 1;
+			pending.back().second = 0;
+			continue;
+		};
+		
+		if(folded < nodes[current].children.size()){
+			pending.back().second++;
+			pending.push_back(make_pair(nodes[current].children[folded], 0u));
+			continue;
+		};
+		
+		pending.pop_back();
+		vector<double> arguments;
+		for(auto it = nodes[current].children.begin(); it != nodes[current].children.end(); it++){
+			if(nodes[*it].token.name != tk_number) break;
+			arguments.push_back(nodes[*it].token.value);
+		};
+		if(!nodes[current].children.empty() && arguments.size() == nodes[current].children.size()){
+			make_number(nodes[current], evaluate_token(nodes[current].token, arguments));
+		};
+	};
+};
+
+// replaces x/c by x*(1/c) for constant c. this is exact if c is a power of two, otherwise only allowed with relaxed math
+// the reciprocal is stored in a new node, since nodes which are no longer reachable after folding may share arguments
+static void reduce_division(vector<token_node>& nodes, bool relaxed){
+	size_t original_size = nodes.size();
+	for(size_t i = 0; i < original_size; i++){
+		if(nodes[i].token.name != tk_ratio || nodes[nodes[i].children[1]].token.name != tk_number) continue;
+		double divisor = nodes[nodes[i].children[1]].token.value;
+		if(divisor == 0 || !isfinite(divisor) || !isnormal(1/divisor)) continue;
+		int exponent;
+		bool exact = (fabs(frexp(divisor, &exponent)) == 0.5);
+		if(!exact && !relaxed) continue;
+		token_node reciprocal;
+		make_number(reciprocal, 1/divisor);
+		nodes.push_back(reciprocal);
+		nodes[i].token.name = tk_times;
+		nodes[i].children[1] = nodes.size() - 1;
+	};
+};
+
+// emits the subtree below root in postfix order. nodes are visited parent first, with the children pushed from left to right,
+// so the reversed visiting order is the postfix order
+static void token_tree_to_postfix(const vector<token_node>& nodes, unsigned int root, deque<math_token>& postfix){
+	vector<unsigned int> pending(1, root);
+	while(!pending.empty()){
+		unsigned int current = pending.back();
+		pending.pop_back();
+		postfix.push_front(nodes[current].token);
+		pending.insert(pending.end(), nodes[current].children.begin(), nodes[current].children.end());
+	};
+};
+
+void formula::optimize_postfix(){
+	// compiler pass between standard_to_postfix() and construct_expression_tree()
+	// the shunting yard algorithm emits operations strictly from left to right, so long sums and products end up as
+	// deep chains where every operation waits for the previous one. this pass converts the postfix formula into a tree
+	// of tokens, rewrites it and emits it again. transformations which are always exact:
+	// (1) division by a power of two is replaced by multiplication
+	// (2) operations on numbers only are replaced by their result, see fold_constants()
+	//     this includes parameters fixed by bind(), which string_to_tokens() already turned into numbers
+	// and only with relaxed_math set:
+	// (3) any division by a constant is replaced by multiplication with its reciprocal
+	// (4) chains of + and * are reassociated into balanced trees, see reassociate()
+	// the tree is kept as a flat list of nodes and all steps work without recursion, so very long formulas cannot
+	// overflow the stack. malformed postfix formulas are left untouched, construct_expression_tree() reports the error
+	vector<token_node> nodes;
+	deque<unsigned int> buffer;
+	for(auto it = postfix_formula.begin(); it != postfix_formula.end(); it++){
+		token_node node;
+		node.token = *it;
+		unsigned int arity = token_arity(*it);
+		if(buffer.size() < arity) return;
+		node.children.assign(buffer.end() - arity, buffer.end());
+		buffer.erase(buffer.end() - arity, buffer.end());
+		nodes.push_back(node);
+		buffer.push_back(nodes.size() - 1);
+	};
+	if(buffer.size() != 1) return;
+	unsigned int root = buffer.back();
+	
+	fold_constants(nodes, root);
+	reduce_division(nodes, relaxed_math);
+	if(relaxed_math) reassociate(nodes);
+	
+	postfix_formula.clear();
+	token_tree_to_postfix(nodes, root, postfix_formula);
+};
+
 void formula::construct_expression_tree(){
 	// this algorithm goes through the tokenized formula in postfix notation. for each basic expression 
 	// (numbers and parameters) it creates an appropriate node, which is stored in the buffer
@@ -351,6 +833,37 @@ void formula::construct_expression_tree(){
 			continue;
 		};
 		
+		if(current_token.name == tk_if){
+			// select, only the chosen branch is evaluated
+			if(buffer.size() < 3){
+				throw runtime_error("syntax error: if requires three arguments");
+			};
+			generic_expression *ptr_else = buffer.back();
+			buffer.pop_back();
+			generic_expression *ptr_then = buffer.back();
+			buffer.pop_back();
+			generic_expression *ptr_condition = buffer.back();
+			buffer.pop_back();
+			new_expression = new if_expression(ptr_condition, ptr_then, ptr_else);
+			all_associated_expressions.push_back(new_expression);
+			buffer.push_back(new_expression);
+			continue;
+		};
+		
+		if(current_token.type == tk_function){
+			// registered functions fetch as many objects from the buffer as their arity says
+			const function_entry& function = get_function_registry().functions[(unsigned int)current_token.value];
+			if(buffer.size() < function.arity){
+				throw runtime_error("syntax error: function " + function.name + " has insufficient number of arguments");
+			};
+			vector<generic_expression*> arguments(buffer.end() - function.arity, buffer.end());
+			buffer.erase(buffer.end() - function.arity, buffer.end());
+			new_expression = new function_expression(arguments, function.kernel);
+			all_associated_expressions.push_back(new_expression);
+			buffer.push_back(new_expression);
+			continue;
+		};
+		
 		if(current_token.type == tk_binary){
 			// same as unary operators, just fetch two objects from buffer
 			if(buffer.size() < 2){
@@ -366,6 +879,14 @@ void formula::construct_expression_tree(){
 			if(current_token.name==tk_ratio) {new_expression = new ratio_expression(ptr_tmp1, ptr_tmp2);};
 			if(current_token.name==tk_power) {new_expression = new power_expression(ptr_tmp1, ptr_tmp2);};	
 			if(current_token.name==tk_neg2) {new_expression = new neg2_expression(ptr_tmp1, ptr_tmp2);};
+			if(current_token.name==tk_less) {new_expression = new less_expression(ptr_tmp1, ptr_tmp2);};
+			if(current_token.name==tk_greater) {new_expression = new greater_expression(ptr_tmp1, ptr_tmp2);};
+			if(current_token.name==tk_less_equal) {new_expression = new less_equal_expression(ptr_tmp1, ptr_tmp2);};
+			if(current_token.name==tk_greater_equal) {new_expression = new greater_equal_expression(ptr_tmp1, ptr_tmp2);};
+			if(current_token.name==tk_equal) {new_expression = new equal_expression(ptr_tmp1, ptr_tmp2);};
+			if(current_token.name==tk_not_equal) {new_expression = new not_equal_expression(ptr_tmp1, ptr_tmp2);};
+			if(current_token.name==tk_and) {new_expression = new and_expression(ptr_tmp1, ptr_tmp2);};
+			if(current_token.name==tk_or) {new_expression = new or_expression(ptr_tmp1, ptr_tmp2);};
 			all_associated_expressions.push_back(new_expression);							
 			buffer.push_back(new_expression);
 			continue;
@@ -376,6 +897,9 @@ void formula::construct_expression_tree(){
 		throw runtime_error("syntax error: formula containers two unconnected expressions");
 		
 	};
+	if(buffer.empty()){
+		throw runtime_error("syntax error: formula does not contain any expression");
+	};
 	ptr_root = buffer.back();
 	
 };
@@ -401,6 +925,17 @@ void disp(const deque<math_token>& deq){
 		if(ntk==tk_number) cout << it->value << ",";			
 		if(ntk==tk_parameter) cout << "x_" << it->value << ",";
 		if(ntk==tk_neg2) cout << "s_neg" <<  ",";
+		if(ntk==tk_comma) cout << "comma,";
+		if(ntk==tk_less) cout << "less,";
+		if(ntk==tk_greater) cout << "greater,";
+		if(ntk==tk_less_equal) cout << "less_equal,";
+		if(ntk==tk_greater_equal) cout << "greater_equal,";
+		if(ntk==tk_equal) cout << "equal,";
+		if(ntk==tk_not_equal) cout << "not_equal,";
+		if(ntk==tk_and) cout << "and,";
+		if(ntk==tk_or) cout << "or,";
+		if(ntk==tk_if) cout << "if,";
+		if(ntk==tk_registered) cout << formula::get_function_registry().functions[(unsigned int)it->value].name << ",";
 	};
 	cout << endl;
 };	
@@ -6,11 +6,13 @@
 // all tokens, are named tk_something, where something should give a clear indication what they refer to
 // type categorizes the object roughly (i.e. number of parameters), whereas name_token specifies the full name
 // math_token.double is a multi-purpose variable, with different meanings depending on math_token.type:
-// for binary operators, it specifies the precedence, i.e. 0 (+/-), 1(* and /), 2 for power and 5 (for negation)
+// for binary operators, it specifies the precedence, i.e. -3 (||), -2 (&&), -1 (comparisons), 0 (+/-), 1(* and /), 2 for power and 5 (for negation)
 // for constant numbers, it simply contains its numerical value
 // for parameters it contains the parameter index, i.e. x0 vs. x5 etc.
-enum type_token {tk_bracket = -1, tk_literal = 0, tk_unary = 1, tk_binary = 2};
-enum name_token {tk_plus = 2,tk_minus = 3,tk_times = 4,tk_ratio = 5, tk_power = 6, tk_number = 0, tk_parameter = 1, tk_sin = 7, tk_cos = 8, tk_exp = 9, tk_log = 10, tk_sqrt = 11, tk_neg = 12, tk_open = 13, tk_close = 14, tk_neg2 = 15}; 
+// for registered functions (tk_function) it contains the index into the function registry
+enum type_token {tk_bracket = -1, tk_literal = 0, tk_unary = 1, tk_binary = 2, tk_function = 3};
+enum name_token {tk_plus = 2,tk_minus = 3,tk_times = 4,tk_ratio = 5, tk_power = 6, tk_number = 0, tk_parameter = 1, tk_sin = 7, tk_cos = 8, tk_exp = 9, tk_log = 10, tk_sqrt = 11, tk_neg = 12, tk_open = 13, tk_close = 14, tk_neg2 = 15, tk_registered = 16, tk_comma = 17,
+	tk_less = 18, tk_greater = 19, tk_less_equal = 20, tk_greater_equal = 21, tk_equal = 22, tk_not_equal = 23, tk_and = 24, tk_or = 25, tk_if = 26}; 
 
 struct math_token{
 	type_token type;
@@ -18,6 +20,28 @@ struct math_token{
 	double value; 
 };
 
+/////////////
+// node of the token tree, which optimize_postfix() temporarily builds from the postfix formula
+// all nodes are stored in one list, children holds the positions of the arguments in that list in their original order
+struct token_node{
+	math_token token;
+	vector<unsigned int> children;
+};
+
+/////////////
+// entry of the function registry, see formula::register_function()
+struct function_entry{
+	string name;
+	unsigned int arity;
+	function_kernel kernel;
+};
+
+// all registered functions. index maps function names to their position in functions, positions never change
+struct function_registry{
+	vector<function_entry> functions;
+	unordered_map<string,unsigned int> index;
+};
+
 ////////////
 // this is a retired helper function, capable of printing token lists, as they are generated in formula; friend of formula
 void disp(const deque<math_token>& deq);
@@ -36,6 +60,10 @@ class formula{
 	deque<math_token> standard_formula; //now substrings are parsed into abstract tokens, minus and negation are reseolved 
 	deque<math_token> postfix_formula;  //converted into postfix notation
 	map<unsigned int,generic_expression*> parameters; //stores parameter expressions and how they can be accessed by their index
+	string error_message = ""; //reason why the last init() failed, empty otherwise
+	map<unsigned int,double> bound_parameters; //parameters which are replaced by constants during parsing, see bind()
+	bool optimize = true; //runs optimize_postfix() during init(), see set_optimization()
+	bool relaxed_math = false; //allows optimize_postfix() to apply transformations which may change rounding, see set_relaxed_math()
 	
 	
 	// list of all associated expression objects, which are 'owned' by this class
@@ -47,11 +75,16 @@ class formula{
 	// helper methods used for parsing
 	void string_to_tokens(); //splits raw_formula into substrings which are then tokenized. uses operators, brackets and spaces as delimiters
 	void standard_to_postfix(); //converts tokenized formula from infix to postfix notation
+	void optimize_postfix(); //rewrites the postfix formula according to a simple cost model, see formula.cpp for details
 	void construct_expression_tree();	//uses the infix formula to generate tree of expression objects
 	
 			
 	// frees all objects which are listed in all_associated_expressions
 	void delete_expressions(); 
+	
+	// returns the global function registry, which is initialized with a few default functions (min, max, abs, ...)
+	// writable, hence private: entries must only be changed through register_function(), which checks them
+	static function_registry& registry();
 
 
 	public:
@@ -65,6 +98,16 @@ class formula{
 	~formula();
 	
 		
+	// read access to the global function registry, including the default functions (min, max, abs, ...)
+	static const function_registry& get_function_registry();
+	
+	// makes a function available to all formulas initialized afterwards, e.g. register_function("hypot", 2, my_hypot)
+	// the kernel receives the evaluated arguments as an array of length arity (1 to max_function_arity)
+	// a call whose arguments are all constant is evaluated once during init() instead of on every evaluate()
+	// registering an existing name replaces the old kernel; built-in functions (sin, cos, ...) cannot be replaced
+	// not thread safe, functions should be registered before formulas are initialized concurrently
+	static void register_function(const string& name, unsigned int arity, function_kernel kernel);
+	
 	//resets object into uninitialized state, deletes all data (including raw formula string)
 	void clear();
 
@@ -73,9 +116,21 @@ class formula{
 	
 	// same as init(), but first removes old data and replaces it with a formula based on new string
 	void init(const string& str);
+	
+	// if set, the next init() may reassociate chains of + and * into balanced trees and replace any division by a constant
+	// with a multiplication by its reciprocal. the reciprocal changes the result in the last bits, but reassociation can change
+	// it arbitrarily when terms cancel: x0+x1+x2+x3 with 1, 1e16, -1e16, 1 gives 1 by default and 0 with relaxed math.
+	// only safe for well-conditioned sums and products (e.g. all terms of the same sign), hence this is off by default
+	void set_relaxed_math(bool flag);
+	
+	// if cleared, the next init() builds the expression tree exactly as the shunting yard algorithm emits it, without
+	// optimize_postfix(). slower, but useful as a reference when checking the optimizations
+	void set_optimization(bool flag);
 		
 	//read type functions
 	const string& get_formula_string(); //returns raw_formula string
+	bool is_initialized(); //true if init() succeeded and the formula can be evaluated
+	const string& get_error(); //returns the message of the parsing error if init() failed, empty string otherwise
 	
 	// returns a map of parameters, just as it should be given to the evaluate() function
 	// the values for each parameter are defaulted to zero 	
@@ -86,6 +141,12 @@ class formula{
 	// then it would expect a map as [(0,value of x0),(3, value of x3)] 
 	double evaluate(const map<unsigned int, double>& params);
 	
+	// partial evaluation: returns a new formula in which the given parameters are replaced by their values
+	// everything that only depends on them is computed once, e.g. binding x0 = 2 in "x1*sqrt(x0+2)+if(x0>1,x2,x3)" leaves "x1*2+x2"
+	// the residual formula only expects the remaining parameters in evaluate() and get_parameter_prototype()
+	// values for parameters which do not occur in the formula are ignored
+	formula bind(const map<unsigned int, double>& values);
+	
 	//retired helper function to print tokenized formula
 	friend void disp(const deque<math_token>& deq); 
 	
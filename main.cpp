@@ -7,6 +7,15 @@ using namespace std;
 #include <ctype.h>
 #include <deque>
 #include <map>
+#include <unordered_map>
+#include <algorithm>
+#include <utility>
+#include <chrono>
+#include <queue>
+#include <functional>
+#include <random>
+#include <limits>
+#include <fstream>
 
 #include "expressions.cpp"
 #include "formula.h"
@@ -22,19 +31,316 @@ using namespace std;
  * numbers (all as doubles) 
  * parameters, which must begin with x, e.g. x0, x1, x[number]. Just'x' is okay too but is defaulted to 'x0'
  * some functions: sin(), cos(), log(), exp(), sqrt()
+ * registered functions with any number of comma separated arguments, by default min(a,b), max(a,b), abs(), atan2(y,x), 
+ * clamp(x,lo,hi), tanh(); more can be added with formula::register_function
  * mathematical operators: +,-,*,/, and ^
+ * comparisons <, >, <=, >=, ==, != and logical &&, || (result is 1 or 0, any non-zero value counts as true)
+ * selection if(condition, a, b), only the selected branch is evaluated
  * the code can distinguish between 'minus' and 'negation'
  * brackets () 
  * The code understands precedence
+ * partial evaluation: formula::bind fixes some parameters and precomputes everything depending only on them
  * 
  * Supported formula examples:
- * "x^2 + 7 - sin(x)", "(3+8)^x0-x1", "1+1--2+8"  
+ * "x^2 + 7 - sin(x)", "(3+8)^x0-x1", "1+1--2+8", "if(x0 < 1 && x1 >= 0, x0, -x1)"  
  * 
  * Tested compilation on: Ubuntu 14.04, g++ (Ubuntu 4.8.5-2ubuntu1~14.04.1) 4.8.5
+ * 
+ * Running the program with the argument 'bench' times a few long formulas unoptimized (formula::set_optimization), with the default
+ * optimizations and with relaxed math (formula::set_relaxed_math)
+ * 
+ * Running it with 'fuzz [count] [seed] [baseline file]' generates random valid and broken formulas, checks that parsing never
+ * crashes and that optimized formulas, copies and partially evaluated formulas (formula::bind) give exactly the same results as
+ * the unoptimized expression tree. relaxed math is checked within a relative tolerance on formulas made of +, * and / only.
+ * the first run records the parse and evaluation throughput in the baseline file (default fuzz_baseline.txt), later runs fail
+ * if they are more than 40% slower. the exit code is non-zero on any disagreement or slowdown. best compiled with sanitizers
+ * for the correctness checks, e.g. g++ -std=c++14 -g -O1 -fsanitize=address,undefined main.cpp
  */
 
 
+// evaluates the formula repeatedly and returns the average time per evaluation in nanoseconds
+double time_evaluation(formula& f, const map<unsigned int,double>& xx, double& result){
+	const int repetitions = 200000;
+	result = 0;
+	auto start = chrono::steady_clock::now();
+	for(int i = 0; i < repetitions; i++){
+		result += f.evaluate(xx);
+	};
+	auto stop = chrono::steady_clock::now();
+	return chrono::duration<double,nano>(stop - start).count() / repetitions;
+};
+
+void benchmark(){
+	// long chains, which the shunting yard algorithm emits as one deep dependency chain
+	string sum = "x0", product = "x0", quotients = "x0/3";
+	for(int i = 1; i < 32; i++){
+		sum += "+x" + to_string(i);
+		product += "*x" + to_string(i);
+		quotients += "+x" + to_string(i) + "/" + to_string(i+2);
+	};
+	// the last one contains constant subexpressions and divisions by powers of two, which the default pass already handles
+	vector<string> formulas = {sum, product, quotients, "sin(x0)*x1+exp(x2)*x3+x4*x5+x6+x7+x8*x9", "x0*(2*3.5+1)/4+sqrt(2)*x1/8-exp(1)*x2"};
+	
+	for(auto it = formulas.begin(); it != formulas.end(); it++){
+		// unoptimized is the tree exactly as the shunting yard algorithm emits it, optimized uses the default (exact) pass
+		formula unoptimized(*it), optimized(*it), relaxed(*it);
+		unoptimized.set_optimization(false);
+		relaxed.set_relaxed_math(true);
+		unoptimized.init();
+		optimized.init();
+		relaxed.init();
+		map<unsigned int,double> xx = unoptimized.get_parameter_prototype();
+		for(auto ix = xx.begin(); ix != xx.end(); ix++) ix->second = 1 + 0.01*ix->first;
+		double result_unoptimized, result_optimized, result_relaxed;
+		double time_unoptimized = time_evaluation(unoptimized, xx, result_unoptimized);
+		double time_optimized = time_evaluation(optimized, xx, result_optimized);
+		double time_relaxed = time_evaluation(relaxed, xx, result_relaxed);
+		cout << it->substr(0,40) << (it->size() > 40 ? "..." : "") << endl;
+		cout << "   unoptimized: " << time_unoptimized << " ns, optimized: " << time_optimized << " ns (speedup ";
+		cout << time_unoptimized/time_optimized << "), relaxed: " << time_relaxed << " ns (speedup " << time_unoptimized/time_relaxed << ")";
+		cout << ", relative difference relaxed: " << fabs(result_unoptimized - result_relaxed)/fabs(result_unoptimized) << endl;
+	};
+};
+
+
+// random formulas for the fuzzing mode
+// all subexpressions are bracketed, exponents are kept small so that not every deeper formula overflows to inf
+string random_formula(mt19937& rng, int depth){
+	static const vector<string> numbers = {"0", "0.5", "1", "2", "3.25", "10"};
+	static const vector<string> binary = {"+", "-", "*", "/", "^", "<", ">", "<=", ">=", "==", "!=", "&&", "||"};
+	static const vector<string> unary = {"sin", "cos", "exp", "log", "sqrt", "abs", "tanh", "-"};
+	static const vector<string> functions = {"min", "max", "atan2"};
+	auto pick = [&rng](const vector<string>& list) -> const string& {return list[rng() % list.size()];};
+	
+	if(depth <= 0 || rng() % 4 == 0){
+		if(rng() % 2 == 0) return pick(numbers);
+		return "x" + to_string(rng() % 5);
+	};
+	switch(rng() % 5){
+		case 0: case 1: {
+			string op = pick(binary);
+			if(op == "^") return "(" + random_formula(rng, depth-1) + ")^" + to_string(rng() % 4);
+			return "(" + random_formula(rng, depth-1) + " " + op + " " + random_formula(rng, depth-1) + ")";
+		};
+		case 2: return pick(unary) + "(" + random_formula(rng, depth-1) + ")";
+		case 3: return pick(functions) + "(" + random_formula(rng, depth-1) + "," + random_formula(rng, depth-1) + ")";
+		default: return "if(" + random_formula(rng, depth-1) + ", " + random_formula(rng, depth-1) + ", " + random_formula(rng, depth-1) + ")";
+	};
+};
+
+// breaks a formula by deleting, inserting or duplicating a few characters
+string mutate_formula(mt19937& rng, string str){
+	static const string alphabet = "()+-*/^,<>=!&|x0123456789.abifsn ";
+	int mutations = 1 + rng() % 3;
+	for(int i = 0; i < mutations; i++){
+		size_t pos = str.empty() ? 0 : rng() % str.size();
+		switch(rng() % 3){
+			case 0: if(!str.empty()) str.erase(pos, 1); break;
+			case 1: str.insert(pos, 1, alphabet[rng() % alphabet.size()]); break;
+			default: str.insert(pos, str.substr(pos, rng() % 8)); break;
+		};
+	};
+	return str;
+};
+
+// formulas made of +, * and / on positive numbers only, used to check relaxed math
+// without subtraction nothing can cancel, so regrouping changes the result by no more than a few rounding errors per operation
+// sometimes a long flat chain is generated, since those are what reassociate() rebuilds
+string random_arithmetic(mt19937& rng, int depth){
+	static const vector<string> numbers = {"0.5", "1", "2", "3.25", "10"};
+	static const vector<string> operators = {"+", "*", "/"};
+	auto pick = [&rng](const vector<string>& list) -> const string& {return list[rng() % list.size()];};
+	
+	if(depth <= 0 || rng() % 4 == 0){
+		if(rng() % 2 == 0) return pick(numbers);
+		return "x" + to_string(rng() % 5);
+	};
+	if(rng() % 3 == 0){
+		string op = (rng() % 2 == 0) ? "+" : "*";
+		string chain = random_arithmetic(rng, min(depth-1, 1));
+		int terms = 2 + rng() % 15;
+		for(int i = 1; i < terms; i++) chain += op + random_arithmetic(rng, min(depth-1, 1));
+		return "(" + chain + ")";
+	};
+	return "(" + random_arithmetic(rng, depth-1) + " " + pick(operators) + " " + random_arithmetic(rng, depth-1) + ")";
+};
+
+// exact agreement, NaN counts as equal to NaN
+bool same_result(double reference, double other){
+	return reference == other || (std::isnan(reference) && std::isnan(other));
+};
+
+// fills xx with random values, keeping the ones listed in fixed
+void random_parameters(mt19937& rng, map<unsigned int,double>& xx, const map<unsigned int,double>& fixed, bool positive){
+	for(auto ix = xx.begin(); ix != xx.end(); ix++){
+		auto known = fixed.find(ix->first);
+		if(known != fixed.end()) ix->second = known->second;
+		else if(positive) ix->second = (1 + (int)(rng() % 200)) / 8.0;
+		else ix->second = (int)(rng() % 200) / 8.0 - 12.5;
+	};
+};
+
+// results of the timed evaluations are written here, which keeps the compiler from dropping them
+volatile double sink;
+
+int fuzz(int count, unsigned int seed, const string& baseline_file){
+	mt19937 rng(seed);
+	vector<string> corpus, arithmetic;
+	for(int i = 0; i < count; i++){
+		string str = random_formula(rng, 1 + rng() % 6);
+		corpus.push_back(rng() % 3 == 0 ? mutate_formula(rng, str) : str);
+	};
+	for(int i = 0; i < count / 4; i++){
+		arithmetic.push_back(random_arithmetic(rng, 1 + rng() % 5));
+	};
+	
+	// parse errors are expected here, keep them out of the output
+	streambuf* cerr_buffer = cerr.rdbuf(nullptr);
+	streamsize old_precision = cout.precision(17); //mismatches may only show in the last digits
+	int failures = 0, initialized = 0;
+	
+	// (1) every way of compiling a formula has to give exactly the same result as the unoptimized expression tree
+	for(auto it = corpus.begin(); it != corpus.end(); it++){
+		formula reference(*it);
+		reference.set_optimization(false);
+		reference.init();
+		formula optimized(*it);
+		optimized.init();
+		if(reference.is_initialized() != optimized.is_initialized()){
+			failures++;
+			cout << "only one of unoptimized and optimized parsing failed for " << *it << endl;
+			continue;
+		};
+		if(!reference.is_initialized()) continue;
+		initialized++;
+		
+		formula copied(optimized);
+		formula moved(move(copied));
+		// partial evaluation with roughly half of the parameters fixed
+		map<unsigned int,double> bound = reference.get_parameter_prototype();
+		for(auto ix = bound.begin(); ix != bound.end();){
+			if(rng() % 2 == 0) ix = bound.erase(ix);
+			else (ix++)->second = (int)(rng() % 200) / 8.0 - 12.5;
+		};
+		formula residual = optimized.bind(bound);
+		
+		map<unsigned int,double> xx = reference.get_parameter_prototype();
+		map<unsigned int,double> free_parameters = residual.get_parameter_prototype();
+		for(int sample = 0; sample < 4; sample++){
+			random_parameters(rng, xx, bound, false);
+			for(auto ix = free_parameters.begin(); ix != free_parameters.end(); ix++) ix->second = xx[ix->first];
+			double expected = reference.evaluate(xx);
+			double from_optimized = optimized.evaluate(xx);
+			double from_moved = moved.evaluate(xx);
+			double from_residual = residual.is_initialized() ? residual.evaluate(free_parameters) : numeric_limits<double>::quiet_NaN();
+			if(!same_result(expected, from_optimized) || !same_result(expected, from_moved) || !same_result(expected, from_residual)){
+				failures++;
+				cout << "mismatch for " << *it << ": unoptimized " << expected << ", optimized " << from_optimized;
+				cout << ", copy " << from_moved << ", partially evaluated " << from_residual << endl;
+				break;
+			};
+		};
+	};
+	
+	// (2) relaxed math may round differently, which is checked on well-conditioned formulas only
+	for(auto it = arithmetic.begin(); it != arithmetic.end(); it++){
+		formula reference(*it), relaxed(*it);
+		reference.set_optimization(false);
+		relaxed.set_relaxed_math(true);
+		reference.init();
+		relaxed.init();
+		if(!reference.is_initialized() || !relaxed.is_initialized()){
+			failures++;
+			cout << "failed to parse " << *it << endl;
+			continue;
+		};
+		map<unsigned int,double> xx = reference.get_parameter_prototype();
+		for(int sample = 0; sample < 4; sample++){
+			random_parameters(rng, xx, map<unsigned int,double>(), true);
+			double expected = reference.evaluate(xx);
+			double from_relaxed = relaxed.evaluate(xx);
+			if(expected != from_relaxed && !(fabs(expected - from_relaxed) <= 1e-12 * fabs(expected))){
+				failures++;
+				cout << "mismatch for " << *it << ": unoptimized " << expected << ", relaxed " << from_relaxed << endl;
+				break;
+			};
+		};
+	};
+	
+	// (3) throughput over the whole corpus, best of five runs to reduce noise
+	deque<formula> compiled;
+	vector<map<unsigned int,double> > samples;
+	for(auto it = corpus.begin(); it != corpus.end(); it++){
+		compiled.emplace_back(*it);
+		compiled.back().init();
+		if(!compiled.back().is_initialized()){
+			compiled.pop_back();
+			continue;
+		};
+		samples.push_back(compiled.back().get_parameter_prototype());
+		random_parameters(rng, samples.back(), map<unsigned int,double>(), false);
+	};
+	const int rounds = 10;
+	double parse_time = numeric_limits<double>::max(), evaluation_time = numeric_limits<double>::max();
+	for(int run = 0; run < 5; run++){
+		auto start = chrono::steady_clock::now();
+		for(auto it = corpus.begin(); it != corpus.end(); it++){
+			formula f(*it);
+			f.init();
+		};
+		auto stop = chrono::steady_clock::now();
+		parse_time = min(parse_time, chrono::duration<double>(stop - start).count());
+		
+		start = chrono::steady_clock::now();
+		for(int round = 0; round < rounds; round++){
+			for(size_t i = 0; i < compiled.size(); i++) sink = compiled[i].evaluate(samples[i]);
+		};
+		stop = chrono::steady_clock::now();
+		evaluation_time = min(evaluation_time, chrono::duration<double>(stop - start).count());
+	};
+	cerr.rdbuf(cerr_buffer);
+	cout.precision(old_precision);
+	
+	double parse_rate = corpus.size() / parse_time;
+	double evaluation_rate = rounds * compiled.size() / evaluation_time;
+	cout << corpus.size() << " formulas, " << initialized << " valid, " << arithmetic.size() << " checked with relaxed math, ";
+	cout << failures << " mismatches" << endl;
+	cout << "parsing: " << parse_rate << " formulas/s, evaluation: " << evaluation_rate << " evaluations/s" << endl;
+	
+	// compare with the throughput recorded by an earlier run, or record it if there is none yet
+	const double allowed_slowdown = 0.6; //timings on shared machines easily vary by 20%
+	double baseline_parse_rate, baseline_evaluation_rate;
+	ifstream baseline_in(baseline_file);
+	if(baseline_in >> baseline_parse_rate >> baseline_evaluation_rate){
+		if(parse_rate < allowed_slowdown * baseline_parse_rate){
+			cout << "parsing throughput dropped below " << allowed_slowdown << " of the baseline " << baseline_parse_rate << " formulas/s" << endl;
+			failures++;
+		};
+		if(evaluation_rate < allowed_slowdown * baseline_evaluation_rate){
+			cout << "evaluation throughput dropped below " << allowed_slowdown << " of the baseline " << baseline_evaluation_rate << " evaluations/s" << endl;
+			failures++;
+		};
+	}
+	else{
+		ofstream baseline_out(baseline_file);
+		baseline_out << parse_rate << " " << evaluation_rate << endl;
+		cout << "no throughput baseline found, recorded this run in " << baseline_file << endl;
+	};
+	return failures == 0 ? 0 : 1;
+};
+
 int main(int argn, char **argv){
+	if(argn > 1 && string(argv[1]) == "bench"){
+		benchmark();
+		return 0;
+	};
+	if(argn > 1 && string(argv[1]) == "fuzz"){
+		int count = (argn > 2) ? atoi(argv[2]) : 10000;
+		unsigned int seed = (argn > 3) ? strtoul(argv[3],nullptr,10) : 1;
+		string baseline_file = (argn > 4) ? argv[4] : "fuzz_baseline.txt";
+		return fuzz(count, seed, baseline_file);
+	};
+	
 	formula test; //declare empty formula
 	string str;
 
@@ -44,6 +350,10 @@ int main(int argn, char **argv){
 	try{
 		cout << "parsing function..." << endl;
 		test.init(str);		//initializing formula with given string and starts parsing
+		if(!test.is_initialized()){
+			cout << "error: " << (test.get_error().empty() ? "empty formula" : test.get_error()) << endl;
+			return 1;
+		};
 		map<unsigned int,double> xx = test.get_parameter_prototype(); //request sample parameter argument
 		cout << "specify parameter values: " << endl;
 		for(auto it = xx.begin(); it != xx.end(); it++){ //fill parameters with values
@@ -52,7 +362,8 @@ int main(int argn, char **argv){
 		};
 	cout << endl << "result: " << test.evaluate(xx) << endl;
 	} 
-	catch(...){
-		cout << "error: nothing can be done" << endl;
+	catch(const exception& e){
+		cout << "error: " << e.what() << endl;
+		return 1;
 	};
 };